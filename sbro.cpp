@@ -150,6 +150,41 @@ struct Huffman {
         buildDecTree();
     }
 
+    // Rebuild canonical codes (and the decode tree) from stored code lengths
+    void buildFromCodeLen(const std::vector<uint8_t>& cl){
+        alphabet = (int)cl.size();
+        codeLen.assign(cl.begin(), cl.end());
+        code.assign(alphabet,0);
+        codeRev.assign(alphabet,0);
+        if (alphabet==0){ buildDecTree(); return; }
+
+        int maxL=0; for(auto L: codeLen) maxL=std::max(maxL,(int)L);
+        if (maxL==0){ codeLen.assign(std::max(1,alphabet),0); codeLen[0]=1; maxL=1; }
+        if (maxL>32) throw std::runtime_error("Huffman: code length too long");
+
+        std::vector<int> bl_count(maxL+1,0);
+        for(auto L: codeLen) if (L) bl_count[L]++;
+
+        // Kraft inequality: over-subscribed lengths would make buildDecTree overwrite leaves
+        uint64_t kraft=0;
+        for(int bits=1; bits<=maxL; ++bits) kraft += (uint64_t)bl_count[bits] << (maxL-bits);
+        if (kraft > (1ull<<maxL)) throw std::runtime_error("Huffman: over-subscribed code lengths");
+
+        std::vector<uint32_t> next_code(maxL+1,0);
+        uint32_t codev=0;
+        for(int bits=1; bits<=maxL; ++bits){
+            codev = (codev + bl_count[bits-1]) << 1;
+            next_code[bits] = codev;
+        }
+        for(int s=0;s<alphabet;s++){
+            int len=codeLen[s];
+            if (!len) continue;
+            code[s]=next_code[len]++;
+            codeRev[s]=reverseBits(code[s], len);
+        }
+        buildDecTree();
+    }
+
     void buildDecTree(){
         nodes.clear(); nodes.push_back(Node());
         for(int s=0;s<alphabet;s++){
@@ -171,6 +206,11 @@ struct Huffman {
         }
     }
 
+    int maxLen() const {
+        int m=0; for(auto L: codeLen) m=std::max(m,(int)L);
+        return m;
+    }
+
     void encSymbol(BitWriter& bw, int s) const {
         int len = codeLen[s];
         bw.writeBits(codeRev[s], len);
@@ -319,39 +359,76 @@ struct LZ77 {
 constexpr int LZ77::WND;
 constexpr int LZ77::MIN_MATCH;
 
+// ========== Little-endian helpers ==========
+static void write_u32_le(std::vector<uint8_t>& buf, uint32_t v){
+    buf.push_back(uint8_t(v & 0xFF));
+    buf.push_back(uint8_t((v>>8) & 0xFF));
+    buf.push_back(uint8_t((v>>16)& 0xFF));
+    buf.push_back(uint8_t((v>>24)& 0xFF));
+}
+static void write_u16_le(std::vector<uint8_t>& buf, uint16_t v){
+    buf.push_back(uint8_t(v & 0xFF));
+    buf.push_back(uint8_t((v>>8) & 0xFF));
+}
+static uint32_t read_u32_le(const uint8_t* p){
+    return uint32_t(p[0]) | (uint32_t(p[1])<<8) | (uint32_t(p[2])<<16) | (uint32_t(p[3])<<24);
+}
+static uint16_t read_u16_le(const uint8_t* p){
+    return uint16_t(p[0]) | (uint16_t(p[1])<<8);
+}
+static uint32_t fnv1a_32(const std::vector<uint8_t>& buf){
+    uint32_t h = 2166136261u;
+    for (uint8_t b : buf){ h ^= b; h *= 16777619u; }
+    return h;
+}
+
 // ========== Codebooks ==========
 struct Codebooks {
+    // Shared codebooks must cover every bucket symbol LZ77::parse can emit:
+    // ins = literals.size() (any uint32), cop = matchLen-3 and dst = distance-1 (both < WND)
+    static constexpr int SHARED_INS_A = 33;
+    static constexpr int SHARED_COP_A = 16;
+    static constexpr int SHARED_DST_A = 16;
+    // Codes are stored in uint32_t (codeRev) and written with one writeBits call
+    static constexpr int SHARED_MAX_LEN = 32;
+
     Huffman lit[4];
     Huffman insLen, copLen, dist;
 
     std::array<std::vector<uint8_t>,4> litCodeLen;
     std::vector<uint8_t> insCodeLen, copCodeLen, distCodeLen;
+    uint32_t id = 0; // fingerprint of the code lengths, only used by shared codebooks
+
+    struct Freq {
+        std::array<std::vector<uint64_t>,4> lit;
+        std::vector<uint64_t> ins, cop, dist;
+        Freq(){
+            for(int c=0;c<4;c++) lit[c].assign(256,0);
+            ins.assign(1,0); cop.assign(1,0); dist.assign(1,0);
+        }
+    };
 
-    void build(const std::vector<Command>& cmds, const std::vector<uint8_t>& original){
-        std::array<std::vector<uint64_t>,4> litFreq;
-        for(int c=0;c<4;c++) litFreq[c].assign(256,0);
-
-        std::vector<uint64_t> insFreq(1,0), copFreq(1,0), distFreq(1,0);
+    static void count(Freq& F, const std::vector<Command>& cmds, const std::vector<uint8_t>& original){
         std::vector<uint8_t> out; out.reserve(original.size());
 
-        auto bumpLenBucket = [&](std::vector<uint64_t>& F, uint32_t val){
+        auto bumpLenBucket = [&](std::vector<uint64_t>& H, uint32_t val){
             auto e = BucketCoder::encode(val);
             int need = (int)e.sym + 1;
-            if ((int)F.size() < need) F.resize(need,0);
-            F[e.sym]++;
+            if ((int)H.size() < need) H.resize(need,0);
+            H[e.sym]++;
         };
 
         for (const auto& cmd : cmds){
             for (uint8_t b : cmd.literals){
                 uint8_t ctx = out.empty()? 3 : charContext(out.back());
-                litFreq[ctx][b]++;
+                F.lit[ctx][b]++;
                 out.push_back(b);
             }
-            bumpLenBucket(insFreq, (uint32_t)cmd.literals.size());
+            bumpLenBucket(F.ins, (uint32_t)cmd.literals.size());
 
             if (cmd.hasMatch){
-                bumpLenBucket(copFreq, cmd.matchLen - 3);
-                bumpLenBucket(distFreq, cmd.distance - 1);
+                bumpLenBucket(F.cop, cmd.matchLen - 3);
+                bumpLenBucket(F.dist, cmd.distance - 1);
                 if (cmd.distance==0 || cmd.distance > out.size())
                     throw std::runtime_error("Invalid distance while simulating");
                 size_t start = out.size() - cmd.distance;
@@ -359,64 +436,177 @@ struct Codebooks {
             }
         }
         if (out != original) throw std::runtime_error("Command stream does not reconstruct input.");
+    }
 
+    void buildFromFreq(const Freq& F){
+        for(int c=0;c<4;c++) lit[c].buildFromFreq(F.lit[c]);
+        insLen.buildFromFreq(F.ins);
+        copLen.buildFromFreq(F.cop);
+        dist.buildFromFreq(F.dist);
+        syncCodeLens();
+    }
+
+    void syncCodeLens(){
         for(int c=0;c<4;c++){
-            lit[c].buildFromFreq(litFreq[c]);
             litCodeLen[c].assign(256,0);
             for(int s=0;s<256;s++) litCodeLen[c][s]=lit[c].codeLen[s];
         }
-        insLen.buildFromFreq(insFreq);
-        copLen.buildFromFreq(copFreq);
-        dist.buildFromFreq(distFreq);
-
         insCodeLen.assign(insLen.codeLen.begin(), insLen.codeLen.end()); if (insCodeLen.empty()) insCodeLen.resize(1,1);
         copCodeLen.assign(copLen.codeLen.begin(), copLen.codeLen.end()); if (copCodeLen.empty()) copCodeLen.resize(1,1);
         distCodeLen.assign(dist.codeLen.begin(), dist.codeLen.end());   if (distCodeLen.empty()) distCodeLen.resize(1,1);
     }
-};
 
-// ========== Little-endian helpers ==========
-static void write_u32_le(std::vector<uint8_t>& buf, uint32_t v){
-    buf.push_back(uint8_t(v & 0xFF));
-    buf.push_back(uint8_t((v>>8) & 0xFF));
-    buf.push_back(uint8_t((v>>16)& 0xFF));
-    buf.push_back(uint8_t((v>>24)& 0xFF));
-}
-static void write_u16_le(std::vector<uint8_t>& buf, uint16_t v){
-    buf.push_back(uint8_t(v & 0xFF));
-    buf.push_back(uint8_t((v>>8) & 0xFF));
-}
-static uint32_t read_u32_le(const uint8_t* p){
-    return uint32_t(p[0]) | (uint32_t(p[1])<<8) | (uint32_t(p[2])<<16) | (uint32_t(p[3])<<24);
-}
-static uint16_t read_u16_le(const uint8_t* p){
-    return uint16_t(p[0]) | (uint16_t(p[1])<<8);
-}
+    void build(const std::vector<Command>& cmds, const std::vector<uint8_t>& original){
+        Freq F; count(F, cmds, original);
+        buildFromFreq(F);
+    }
 
-// ========== Encoder ==========
-static std::vector<uint8_t> compress_sbro(const std::vector<uint8_t>& input){
-    auto cmds = LZ77::parse(input);
+    // Build a codebook set once from sample messages; later frames reference it by id.
+    // Every symbol gets a code (+1 smoothing) so messages unseen in training stay encodable.
+    void train(const std::vector<std::vector<uint8_t>>& samples){
+        Freq F;
+        for (const auto& s : samples) count(F, LZ77::parse(s), s);
+        F.ins.resize(SHARED_INS_A,0);
+        F.cop.resize(SHARED_COP_A,0);
+        F.dist.resize(SHARED_DST_A,0);
+
+        // Large training sets can produce very deep trees; flatten only the table
+        // that is too deep until its codes fit SHARED_MAX_LEN
+        auto buildLimited = [](Huffman& h, std::vector<uint64_t> freq){
+            for(auto& f: freq) f += 1;
+            while (true){
+                h.buildFromFreq(freq);
+                if (h.maxLen() <= SHARED_MAX_LEN) return;
+                for(auto& f: freq) f = (f+1)/2;
+            }
+        };
+        for(int c=0;c<4;c++) buildLimited(lit[c], F.lit[c]);
+        buildLimited(insLen, F.ins);
+        buildLimited(copLen, F.cop);
+        buildLimited(dist, F.dist);
+        syncCodeLens();
+
+        std::vector<uint8_t> tables; writeCodeLens(tables);
+        id = fnv1a_32(tables);
+    }
 
-    Codebooks cb; cb.build(cmds, input);
+    int maxCodeLen() const {
+        int m=0;
+        for(int c=0;c<4;c++) m=std::max(m, lit[c].maxLen());
+        m=std::max(m, insLen.maxLen());
+        m=std::max(m, copLen.maxLen());
+        m=std::max(m, dist.maxLen());
+        return m;
+    }
 
-    std::vector<uint8_t> out;
-    out.insert(out.end(), {'S','B','R','O'});
-    out.push_back(1);
-    write_u32_le(out, (uint32_t)input.size());
+    // True if every symbol a message may need has a code
+    bool coversAllSymbols() const {
+        if ((int)insCodeLen.size() < SHARED_INS_A || (int)copCodeLen.size() < SHARED_COP_A
+            || (int)distCodeLen.size() < SHARED_DST_A) return false;
+        for(int c=0;c<4;c++) for(auto L: litCodeLen[c]) if (!L) return false;
+        for(auto L: insCodeLen)  if (!L) return false;
+        for(auto L: copCodeLen)  if (!L) return false;
+        for(auto L: distCodeLen) if (!L) return false;
+        return true;
+    }
+
+    // <uint16_t: ins/cop/dst alphabet size> <4*256 + insA + copA + dstA bytes: code lengths>
+    void writeCodeLens(std::vector<uint8_t>& out) const {
+        write_u16_le(out, (uint16_t)insCodeLen.size());
+        write_u16_le(out, (uint16_t)copCodeLen.size());
+        write_u16_le(out, (uint16_t)distCodeLen.size());
+        for(int c=0;c<4;c++) for(int s=0;s<256;s++) out.push_back(litCodeLen[c][s]);
+        out.insert(out.end(), insCodeLen.begin(), insCodeLen.end());
+        out.insert(out.end(), copCodeLen.begin(), copCodeLen.end());
+        out.insert(out.end(), distCodeLen.begin(), distCodeLen.end());
+    }
 
-    uint16_t insA = (uint16_t)std::max<size_t>(cb.insCodeLen.size(), 1);
-    uint16_t copA = (uint16_t)std::max<size_t>(cb.copCodeLen.size(), 1);
-    uint16_t dstA = (uint16_t)std::max<size_t>(cb.distCodeLen.size(),1);
-    write_u16_le(out, insA);
-    write_u16_le(out, copA);
-    write_u16_le(out, dstA);
+    // Inverse of writeCodeLens; rebuilds all Huffman tables. Returns offset past the tables.
+    size_t readCodeLens(const std::vector<uint8_t>& in, size_t off){
+        if (in.size() < off+6+4*256) throw std::runtime_error("Code length tables truncated");
+        uint16_t insA = read_u16_le(&in[off]); off+=2;
+        uint16_t copA = read_u16_le(&in[off]); off+=2;
+        uint16_t dstA = read_u16_le(&in[off]); off+=2;
+        if (in.size() < off+4*256+insA+copA+dstA) throw std::runtime_error("Code length tables truncated");
+
+        for(int c=0;c<4;c++){ litCodeLen[c].assign(in.begin()+off, in.begin()+off+256); off+=256; }
+        insCodeLen.assign(in.begin()+off, in.begin()+off+insA); off+=insA;
+        copCodeLen.assign(in.begin()+off, in.begin()+off+copA); off+=copA;
+        distCodeLen.assign(in.begin()+off, in.begin()+off+dstA); off+=dstA;
+
+        for(int c=0;c<4;c++) lit[c].buildFromCodeLen(litCodeLen[c]);
+        insLen.buildFromCodeLen(insCodeLen);
+        copLen.buildFromCodeLen(copCodeLen);
+        dist.buildFromCodeLen(distCodeLen);
+        return off;
+    }
 
-    for(int c=0;c<4;c++) for(int s=0;s<256;s++) out.push_back(cb.litCodeLen[c][s]);
-    for(size_t i=0;i<insA;i++) out.push_back( i<cb.insCodeLen.size()? cb.insCodeLen[i] : 0 );
-    for(size_t i=0;i<copA;i++) out.push_back( i<cb.copCodeLen.size()? cb.copCodeLen[i] : 0 );
-    for(size_t i=0;i<dstA;i++) out.push_back( i<cb.distCodeLen.size()? cb.distCodeLen[i] : 0 );
+    std::vector<uint8_t> serialize() const {
+        std::vector<uint8_t> out;
+        out.insert(out.end(), {'S','B','C','B'});
+        out.push_back(1);
+        write_u32_le(out, id);
+        writeCodeLens(out);
+        return out;
+    }
+    void deserialize(const std::vector<uint8_t>& in){
+        if (in.size()<4+1+4) throw std::runtime_error("Codebook too small");
+        if (!(in[0]=='S'&&in[1]=='B'&&in[2]=='C'&&in[3]=='B')) throw std::runtime_error("Bad codebook magic");
+        if (in[4]!=1) throw std::runtime_error("Unsupported codebook version");
+        uint32_t storedId = read_u32_le(&in[5]);
+        if (readCodeLens(in, 9) != in.size()) throw std::runtime_error("Trailing bytes after codebook tables");
+
+        std::vector<uint8_t> tables; writeCodeLens(tables);
+        if (fnv1a_32(tables) != storedId) throw std::runtime_error("Codebook id does not match its tables");
+        if (!coversAllSymbols() || maxCodeLen() > SHARED_MAX_LEN) throw std::runtime_error("Codebook is not usable as a shared codebook");
+        id = storedId;
+    }
+};
+constexpr int Codebooks::SHARED_INS_A;
+constexpr int Codebooks::SHARED_COP_A;
+constexpr int Codebooks::SHARED_DST_A;
+constexpr int Codebooks::SHARED_MAX_LEN;
+/*
+SBCB
+1
+<uint32_t: codebook id (FNV-1a of the code length tables below)>
+<uint16_t: ins alphabet size>
+<uint16_t: cop alphabet size>
+<uint16_t: dst alphabet size>
+<256 bytes * 4: literal code lengths for 4 contexts>
+<insA bytes: insert length code lengths>
+<copA bytes: copy length code lengths>
+<dstA bytes: distance code lengths>
+*/
 
-    BitWriter bw;
+// ========== Codebook cache (decoder side) ==========
+// Decode trees of shared codebooks are built once on load and reused by every frame.
+struct CodebookCache {
+    std::unordered_map<uint32_t, Codebooks> byId;
+
+    const Codebooks& add(const std::vector<uint8_t>& serialized){
+        Codebooks cb; cb.deserialize(serialized);
+        uint32_t id = cb.id;
+        auto it = byId.find(id);
+        if (it!=byId.end()){
+            // Ids are a 32-bit hash; a different codebook with the same id would decode garbage
+            const Codebooks& old = it->second;
+            if (old.litCodeLen!=cb.litCodeLen || old.insCodeLen!=cb.insCodeLen
+                || old.copCodeLen!=cb.copCodeLen || old.distCodeLen!=cb.distCodeLen)
+                throw std::runtime_error("Codebook id collides with a different cached codebook");
+            return old;
+        }
+        return byId.emplace(id, std::move(cb)).first->second;
+    }
+    const Codebooks* find(uint32_t id) const {
+        auto it = byId.find(id);
+        return it==byId.end()? nullptr : &it->second;
+    }
+};
+
+// ========== Encoder ==========
+static void encode_commands(BitWriter& bw, const std::vector<Command>& cmds, const Codebooks& cb,
+                            const std::vector<uint8_t>& input){
     std::vector<uint8_t> recon; recon.reserve(input.size());
 
     for (const auto& cmd : cmds){
@@ -448,7 +638,21 @@ static std::vector<uint8_t> compress_sbro(const std::vector<uint8_t>& input){
         }
     }
     if (recon != input) throw std::runtime_error("Encoder self-check failed.");
+}
+
+static std::vector<uint8_t> compress_sbro(const std::vector<uint8_t>& input){
+    auto cmds = LZ77::parse(input);
+
+    Codebooks cb; cb.build(cmds, input);
+
+    std::vector<uint8_t> out;
+    out.insert(out.end(), {'S','B','R','O'});
+    out.push_back(1);
+    write_u32_le(out, (uint32_t)input.size());
+    cb.writeCodeLens(out);
 
+    BitWriter bw;
+    encode_commands(bw, cmds, cb, input);
     bw.flushTo(out);
     return out;
 }
@@ -466,67 +670,38 @@ SBRO
 <bitstream>
 */
 
-// ========== Decoder ==========
-static std::vector<uint8_t> decompress_sbro(const std::vector<uint8_t>& in){
-    if (in.size()<4+1+4+6+4*256) throw std::runtime_error("Input too small");
-    if (!(in[0]=='S'&&in[1]=='B'&&in[2]=='R'&&in[3]=='O')) throw std::runtime_error("Bad magic");
-    uint8_t ver = in[4]; if (ver!=1) throw std::runtime_error("Unsupported version");
-    size_t off = 5;
-    uint32_t rawSize = read_u32_le(&in[off]); off+=4;
-
-    uint16_t insA = read_u16_le(&in[off]); off+=2;
-    uint16_t copA = read_u16_le(&in[off]); off+=2;
-    uint16_t dstA = read_u16_le(&in[off]); off+=2;
-
-    std::array<std::vector<uint8_t>,4> litCL;
-    for(int c=0;c<4;c++){ litCL[c].resize(256); for(int s=0;s<256;s++) litCL[c][s]=in[off++]; }
-    std::vector<uint8_t> insCL(insA), copCL(copA), dstCL(dstA);
-    for(int i=0;i<insA;i++) insCL[i]=in[off++];
-    for(int i=0;i<copA;i++) copCL[i]=in[off++];
-    for(int i=0;i<dstA;i++) dstCL[i]=in[off++];
-
-    auto buildFromCL = [](Huffman& h, const std::vector<uint8_t>& cl){
-        h.alphabet = (int)cl.size();
-        h.codeLen.assign(cl.begin(), cl.end());
-        h.code.assign(h.alphabet,0);
-        h.codeRev.assign(h.alphabet,0);
-        if (h.alphabet==0){ h.buildDecTree(); return; }
-
-        int maxL=0; for(auto L: h.codeLen) maxL=std::max(maxL,(int)L);
-        if (maxL==0){ h.codeLen.assign(std::max(1,h.alphabet),0); h.codeLen[0]=1; maxL=1; }
-
-        std::vector<int> bl_count(maxL+1,0);
-        for(auto L: h.codeLen) if (L) bl_count[L]++;
-
-        std::vector<uint32_t> next_code(maxL+1,0);
-        uint32_t codev=0;
-        for(int bits=1; bits<=maxL; ++bits){
-            codev = (codev + bl_count[bits-1]) << 1;
-            next_code[bits] = codev;
-        }
-        for(int s=0;s<h.alphabet;s++){
-            int len=h.codeLen[s];
-            if (!len) continue;
-            h.code[s]=next_code[len]++;
-            h.codeRev[s]=Huffman::reverseBits(h.code[s], len);
-        }
-        h.buildDecTree();
-    };
+// Small-message frame: no histogramming or tree building, codes come from a trained codebook
+static std::vector<uint8_t> compress_sbro(const std::vector<uint8_t>& input, const Codebooks& shared){
+    if (!shared.coversAllSymbols()) throw std::runtime_error("Codebook is not usable as a shared codebook");
+    auto cmds = LZ77::parse(input);
 
-    Huffman lit[4], insH, copH, dstH;
-    for(int c=0;c<4;c++) buildFromCL(lit[c], litCL[c]);
-    buildFromCL(insH, insCL);
-    buildFromCL(copH, copCL);
-    buildFromCL(dstH, dstCL);
+    std::vector<uint8_t> out;
+    out.insert(out.end(), {'S','B','R','O'});
+    out.push_back(2);
+    write_u32_le(out, (uint32_t)input.size());
+    write_u32_le(out, shared.id);
 
-    BitReader br(in.data()+off, in.size()-off);
+    BitWriter bw;
+    encode_commands(bw, cmds, shared, input);
+    bw.flushTo(out);
+    return out;
+}
+/*
+SBRO
+2
+<uint32_t: raw size>
+<uint32_t: codebook id>
+<bitstream>
+*/
 
-    std::vector<uint8_t> out; out.reserve(rawSize);
+// ========== Decoder ==========
+static void decode_commands(BitReader& br, const Codebooks& cb, uint32_t rawSize, std::vector<uint8_t>& out){
+    out.reserve(rawSize);
     while (out.size() < rawSize){
-		uint32_t insVal = BucketCoder::decodeFromStream(insH, br);
+		uint32_t insVal = BucketCoder::decodeFromStream(cb.insLen, br);
         for(uint32_t i=0;i<insVal;i++){
             uint8_t ctx = out.empty()? 3 : charContext(out.back());
-            int litSym = lit[ctx].decSymbol(br);
+            int litSym = cb.lit[ctx].decSymbol(br);
             out.push_back((uint8_t)litSym);
             if (out.size() > rawSize) throw std::runtime_error("Decoded beyond raw size (literals).");
         }
@@ -535,9 +710,9 @@ static std::vector<uint8_t> decompress_sbro(const std::vector<uint8_t>& in){
         uint32_t hasM = br.readBit();
         if (!hasM) continue;
 
-		uint32_t lenVal = BucketCoder::decodeFromStream(copH, br);
+		uint32_t lenVal = BucketCoder::decodeFromStream(cb.copLen, br);
         uint32_t matchLen = lenVal + 3;
-		uint32_t dstVal = BucketCoder::decodeFromStream(dstH, br);
+		uint32_t dstVal = BucketCoder::decodeFromStream(cb.dist, br);
         uint32_t dist = dstVal + 1;
         if (dist==0 || dist>out.size()) throw std::runtime_error("Bad distance while decoding");
         size_t start = out.size() - dist;
@@ -547,6 +722,31 @@ static std::vector<uint8_t> decompress_sbro(const std::vector<uint8_t>& in){
         }
     }
     if (out.size()!=rawSize) throw std::runtime_error("Decoded size mismatch");
+}
+
+static std::vector<uint8_t> decompress_sbro(const std::vector<uint8_t>& in, const CodebookCache* cache = nullptr){
+    if (in.size()<4+1+4) throw std::runtime_error("Input too small");
+    if (!(in[0]=='S'&&in[1]=='B'&&in[2]=='R'&&in[3]=='O')) throw std::runtime_error("Bad magic");
+    uint8_t ver = in[4];
+    size_t off = 5;
+    uint32_t rawSize = read_u32_le(&in[off]); off+=4;
+
+    std::vector<uint8_t> out;
+    if (ver==1){
+        Codebooks cb;
+        off = cb.readCodeLens(in, off);
+        BitReader br(in.data()+off, in.size()-off);
+        decode_commands(br, cb, rawSize, out);
+    }else if (ver==2){
+        if (in.size()<off+4) throw std::runtime_error("Input too small");
+        uint32_t id = read_u32_le(&in[off]); off+=4;
+        const Codebooks* cb = cache? cache->find(id) : nullptr;
+        if (!cb) throw std::runtime_error("Frame needs shared codebook that is not loaded");
+        BitReader br(in.data()+off, in.size()-off);
+        decode_commands(br, *cb, rawSize, out);
+    }else{
+        throw std::runtime_error("Unsupported version");
+    }
     return out;
 }
 
@@ -595,21 +795,55 @@ static void writeAll(const std::string& path, const std::vector<uint8_t>& data){
 
 // ========== CLI ==========
 int main(int argc, char** argv){
-    if (argc!=4){
+    // "train" is reserved as the first argument; message files named zip/unzip are
+    // rejected so "train <out> zip" can never be mistaken for either command
+    bool train = argc>=4 && std::string(argv[1])=="train";
+    bool bad = train? std::any_of(argv+3, argv+argc, [](const char* a){
+                          return std::string(a)=="zip" || std::string(a)=="unzip"; })
+                    : (argc!=4 && argc!=5);
+    if (bad){
         std::cerr << "Usage:\n"
-                  << "  " << argv[0] << " <input> <output> zip\n"
-                  << "  " << argv[0] << " <input> <output> unzip\n"
+                  << "  " << argv[0] << " <input> <output> zip [codebook]\n"
+                  << "  " << argv[0] << " <input> <output> unzip [codebook]\n"
+                  << "  " << argv[0] << " train <codebook> <msg1> [msg2 ...]\n"
+                  << "  (use ./train, ./zip or ./unzip for files with those names)\n"
 				  << "Example:\n"
 				  << "  " << argv[0] << " ser.log ser.log.sbro zip\n"
-				  << "  " << argv[0] << " ser.log.sbro ser_rec.log unzip\n";
+				  << "  " << argv[0] << " ser.log.sbro ser_rec.log unzip\n"
+				  << "  " << argv[0] << " train ser.sbcb req1.json req2.json req3.json\n"
+				  << "  " << argv[0] << " req.json req.json.sbro zip ser.sbcb\n";
         return 1;
     }
+    if (train){
+        try{
+            // Each file is one sample message, so LZ77 statistics match per-message frames
+            std::vector<std::vector<uint8_t>> samples;
+            for(int i=3;i<argc;i++) samples.push_back(edu::readAll(argv[i]));
+			auto start_time = std::chrono::high_resolution_clock::now();
+            edu::Codebooks cb; cb.train(samples);
+            edu::writeAll(argv[2], cb.serialize());
+			auto end_time = std::chrono::high_resolution_clock::now();
+			auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+			std::cout << "Codebook trained on " << samples.size() << " messages in " << duration.count() << " ms\n";
+			std::cout << "Codebook id: " << std::hex << std::setw(8) << std::setfill('0') << cb.id << std::dec << "\n";
+        }catch(const std::exception& e){
+            std::cerr << "[ERROR] " << e.what() << "\n";
+            return 2;
+        }
+        return 0;
+    }
     std::string inPath=argv[1], outPath=argv[2], mode = argv[3];
+    std::string cbPath = argc==5? argv[4] : "";
     try{
         auto data = edu::readAll(inPath);
         if (mode=="zip"){
 			auto start_time = std::chrono::high_resolution_clock::now();
-            auto enc = edu::compress_sbro(data);
+            std::vector<uint8_t> enc;
+            if (cbPath.empty()) enc = edu::compress_sbro(data);
+            else {
+                edu::Codebooks cb; cb.deserialize(edu::readAll(cbPath));
+                enc = edu::compress_sbro(data, cb);
+            }
             edu::writeAll(outPath, enc);
 			auto end_time = std::chrono::high_resolution_clock::now();
 			auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
@@ -626,7 +860,9 @@ int main(int argc, char** argv){
 			}
         }else if (mode=="unzip"){
 			auto start_time = std::chrono::high_resolution_clock::now();
-            auto dec = edu::decompress_sbro(data);
+            edu::CodebookCache cache;
+            if (!cbPath.empty()) cache.add(edu::readAll(cbPath));
+            auto dec = edu::decompress_sbro(data, &cache);
             edu::writeAll(outPath, dec);
 			auto end_time = std::chrono::high_resolution_clock::now();
 			auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);